@@ -0,0 +1,18 @@
+#pragma once
+
+#include "WiFiConnectionManager.h"
+
+// WiFiRadio backed by the ESP32 Arduino WiFi library. The access point keeps
+// running alongside the station (WIFI_AP_STA).
+class EspWiFiRadio : public WiFiRadio {
+ public:
+  void begin(const char* ssid, const char* password, const WiFiFastConnectCache* cache) override;
+  void disconnect() override;
+  bool isConnected() override;
+  uint8_t failureReason() override { return disconnectReason_; }
+  void readLink(WiFiFastConnectCache& cache) override;
+
+ private:
+  bool eventsRegistered_ = false;
+  volatile uint8_t disconnectReason_ = 0;  // Written by the WiFi event task
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Compact append-only telemetry log kept on LittleFS.
+//
+// The log is a ring of TLOG_SEGMENT_COUNT segment files. Each segment starts
+// with a TelemetrySegmentHeader followed by fixed-size 8-byte TelemetryRecords.
+// Record timestamps are delta-encoded: a record's time is the previous record's
+// time (or the segment's baseTime) plus dt seconds. When the delta does not fit
+// in 16 bits or time goes backwards (reboot before NTP, NTP step), a
+// TLOG_TIME_BASE record carrying the absolute time is written first.
+//
+// Times come from time(nullptr): seconds since boot until NTP has synced, Unix
+// time afterwards.
+//
+// A /log?format=bin download is the segments concatenated oldest first, each
+// cut at its last whole record. Segment boundaries are found by the header
+// magic: its third byte sits where a record keeps its type, and no event type
+// has that value.
+//
+// This header has no Arduino dependencies so the format, the ring bookkeeping
+// and the decoder can be reused by host-side tools and tests.
+
+#define TLOG_MAGIC 0x31474C43UL  // "CLG1"
+#define TLOG_SEGMENT_COUNT 8
+#define TLOG_SEGMENT_BYTES 4096
+
+enum TelemetryEvent : uint8_t {
+  TLOG_TIME_BASE = 0,   // value = absolute time, resets the delta chain
+  TLOG_REBOOT = 1,      // aux = esp_reset_reason(), value = free heap at boot
+  TLOG_NTP_RESYNC = 2,  // value = timezone offset used for the sync (seconds)
+  TLOG_NTP_OFFSET = 3,  // value = NTP minus internal clock in UTC (seconds); only once the clock was set
+  TLOG_TIME_SET = 4,    // value = manual minus internal clock in UTC (seconds); aux = 1 if never set
+  TLOG_HEAP_LOW = 5,    // value = new heap low-water mark (bytes)
+  TLOG_WIFI_DROP = 6,   // aux = disconnect reason (wifi_err_reason_t), value = 1 on connect timeout
+};
+
+struct TelemetrySegmentHeader {
+  uint32_t magic;       // TLOG_MAGIC
+  uint32_t seq;         // Monotonic segment sequence number, orders the ring
+  uint32_t baseTime;    // Time the first record's delta is relative to
+  uint16_t recordSize;  // sizeof(TelemetryRecord)
+  uint16_t reserved;
+};
+
+struct TelemetryRecord {
+  uint16_t dt;    // Seconds since the previous record in the segment
+  uint8_t type;   // TelemetryEvent
+  uint8_t aux;    // Event-specific small value
+  int32_t value;  // Event-specific value
+};
+
+static_assert(sizeof(TelemetrySegmentHeader) == 16, "segment header must be 16 bytes");
+static_assert(sizeof(TelemetryRecord) == 8, "telemetry record must be 8 bytes");
+static_assert(((TLOG_MAGIC >> 16) & 0xFF) > TLOG_WIFI_DROP, "header magic must not look like a record");
+
+const size_t TLOG_RECORDS_PER_SEGMENT =
+    (TLOG_SEGMENT_BYTES - sizeof(TelemetrySegmentHeader)) / sizeof(TelemetryRecord);
+
+inline bool telemetryHeaderValid(const TelemetrySegmentHeader& h) {
+  return h.magic == TLOG_MAGIC && h.recordSize == sizeof(TelemetryRecord);
+}
+
+// Rebuilds absolute record times while walking one segment in order.
+struct TelemetryDecoder {
+  uint32_t time = 0;
+
+  void beginSegment(const TelemetrySegmentHeader& h) { time = h.baseTime; }
+
+  uint32_t apply(const TelemetryRecord& r) {
+    if (r.type == TLOG_TIME_BASE) {
+      time = (uint32_t)r.value;
+    } else {
+      time += r.dt;
+    }
+    return time;
+  }
+};
+
+// Writer-side bookkeeping for the segment ring, independent of the filesystem.
+struct TelemetryRingWriter {
+  uint8_t index = TLOG_SEGMENT_COUNT - 1;  // Ring slot of the current segment
+  uint32_t seq = 0;                        // Its sequence number, 0 = none yet
+  uint32_t baseTime = 0;
+  size_t records = 0;
+  uint32_t lastTime = 0;
+
+  // Moves to the next ring slot and starts an empty segment there.
+  void rotate(uint32_t time) {
+    index = (index + 1) % TLOG_SEGMENT_COUNT;
+    seq++;
+    baseTime = time;
+    records = 0;
+    lastTime = time;
+  }
+
+  TelemetrySegmentHeader header() const {
+    TelemetrySegmentHeader h = {};
+    h.magic = TLOG_MAGIC;
+    h.seq = seq;
+    h.baseTime = baseTime;
+    h.recordSize = sizeof(TelemetryRecord);
+    return h;
+  }
+
+  // Encodes one event into out (a TLOG_TIME_BASE record first when the delta
+  // does not fit) and returns the record count. Sets rotated when the segment
+  // was full and the records start a new one, whose header() must be written
+  // first.
+  size_t append(uint32_t time, uint8_t type, uint8_t aux, int32_t value,
+                TelemetryRecord out[2], bool& rotated) {
+    bool needBase = time < lastTime || time - lastTime > 0xFFFF;
+    rotated = seq == 0 || records + (needBase ? 2 : 1) > TLOG_RECORDS_PER_SEGMENT;
+    if (rotated) {
+      rotate(time);
+      needBase = false;
+    }
+
+    size_t n = 0;
+    if (needBase) {
+      out[n++] = {0, TLOG_TIME_BASE, 0, (int32_t)time};
+      lastTime = time;
+    }
+    out[n++] = {(uint16_t)(time - lastTime), type, aux, value};
+    lastTime = time;
+    records += n;
+    return n;
+  }
+};
+
+// One segment found in a /log?format=bin download.
+struct TelemetrySegmentSpan {
+  TelemetrySegmentHeader header;
+  size_t offset;   // Byte offset of the first record
+  size_t records;  // Number of whole records
+};
+
+inline bool telemetryHeaderAt(const uint8_t* data, size_t len, size_t pos, TelemetrySegmentHeader& h) {
+  if (pos + sizeof(h) > len) return false;
+  memcpy(&h, data + pos, sizeof(h));
+  return telemetryHeaderValid(h);
+}
+
+// Splits a raw download into segments sorted by sequence number, oldest
+// first. Bytes that belong to no segment are skipped. Returns the number of
+// segments stored in out (at most maxSegments).
+inline size_t telemetrySplitSegments(const uint8_t* data, size_t len,
+                                     TelemetrySegmentSpan* out, size_t maxSegments) {
+  size_t count = 0;
+  size_t pos = 0;
+  TelemetrySegmentHeader h;
+  while (pos + sizeof(h) <= len) {
+    if (!telemetryHeaderAt(data, len, pos, h)) {
+      pos += sizeof(TelemetryRecord);  // Resync on the record grid
+      continue;
+    }
+    TelemetrySegmentSpan span = {h, pos + sizeof(h), 0};
+    pos = span.offset;
+    TelemetrySegmentHeader next;
+    while (pos + sizeof(TelemetryRecord) <= len && !telemetryHeaderAt(data, len, pos, next)) {
+      span.records++;
+      pos += sizeof(TelemetryRecord);
+    }
+    if (count == maxSegments) break;
+
+    // Insertion sort by sequence number
+    size_t i = count++;
+    while (i > 0 && out[i - 1].header.seq > span.header.seq) {
+      out[i] = out[i - 1];
+      i--;
+    }
+    out[i] = span;
+  }
+  return count;
+}
+
+inline TelemetryRecord telemetryRecordAt(const uint8_t* data, const TelemetrySegmentSpan& span, size_t i) {
+  TelemetryRecord r;
+  memcpy(&r, data + span.offset + i * sizeof(TelemetryRecord), sizeof(r));
+  return r;
+}
+
+inline const char* telemetryEventName(uint8_t type) {
+  switch (type) {
+    case TLOG_TIME_BASE: return "time_base";
+    case TLOG_REBOOT: return "reboot";
+    case TLOG_NTP_RESYNC: return "ntp_resync";
+    case TLOG_NTP_OFFSET: return "ntp_offset";
+    case TLOG_TIME_SET: return "time_set";
+    case TLOG_HEAP_LOW: return "heap_low";
+    case TLOG_WIFI_DROP: return "wifi_drop";
+    default: return "unknown";
+  }
+}
+
+#ifdef ARDUINO
+
+// Mounts LittleFS, resumes the newest segment and records a TLOG_REBOOT event.
+void telemetryLogBegin();
+// Queues a record in RAM. Safe to call from web server callbacks.
+void telemetryLogAppend(TelemetryEvent type, uint8_t aux, int32_t value);
+// Call from loop(): writes queued records when the flush timer expires.
+void telemetryLogHandle();
+// Writes all queued records to flash now.
+void telemetryLogFlush();
+
+// Streams the log out of flash in small pieces, oldest segment first, either as
+// CSV lines or as the raw segment images. Records still queued in RAM are not
+// included.
+class TelemetryLogReader {
+ public:
+  explicit TelemetryLogReader(bool csv);
+  // Fills up to maxLen bytes; returns 0 once the whole log has been read.
+  size_t read(uint8_t* buf, size_t maxLen);
+
+ private:
+  bool openSegment();
+  size_t readSegment(uint8_t* buf, size_t maxLen);
+  size_t readRaw(uint8_t* buf, size_t maxLen);
+  bool nextRecord(TelemetryRecord& rec);
+  bool nextLine();
+
+  bool csv_;
+  uint8_t order_[TLOG_SEGMENT_COUNT];
+  uint32_t seqs_[TLOG_SEGMENT_COUNT];
+  size_t segmentCount_ = 0;
+  size_t segmentPos_ = 0;
+  size_t offset_ = 0;  // Byte offset in the current segment file
+  size_t end_ = 0;     // End of the last whole record in the current segment
+  bool segmentOpen_ = false;
+  TelemetryDecoder decoder_;
+  TelemetryRecord records_[16];
+  size_t recordCount_ = 0;
+  size_t recordPos_ = 0;
+  char line_[64];
+  size_t lineLen_ = 0;
+  size_t linePos_ = 0;
+  bool headerSent_ = false;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// WiFi station connection state machine.
+//
+//   IDLE --connect()--> FAST --timeout--> SCAN --timeout--> BACKOFF
+//                        |                 |                  |
+//                        +----connected----+--> CONNECTED     +--delay--> FAST/SCAN
+//                                               |
+//                                               +--link lost--> FAST/SCAN
+//
+// FAST reuses the cached BSSID and channel of the last good link, which skips
+// the channel scan. The address still comes from DHCP, so an expired lease is
+// never reused. SCAN is a cold connect. Failed
+// attempts back off exponentially with jitter so a crowd of clocks does not
+// retry in lockstep.
+//
+// The radio is reached only through WiFiRadio and time is passed in, so the
+// state machine has no Arduino dependencies and can be driven on the host by a
+// scripted fake radio.
+
+const unsigned long WIFI_FAST_CONNECT_TIMEOUT_MS = 5000;
+const unsigned long WIFI_SCAN_CONNECT_TIMEOUT_MS = 20000;
+const unsigned long WIFI_BACKOFF_BASE_MS = 1000;
+const unsigned long WIFI_BACKOFF_MAX_MS = 60000;
+const size_t WIFI_CONNECT_SAMPLES = 16;
+
+enum WiFiConnState : uint8_t {
+  WIFI_CONN_IDLE,
+  WIFI_CONN_FAST,
+  WIFI_CONN_SCAN,
+  WIFI_CONN_CONNECTED,
+  WIFI_CONN_BACKOFF,
+};
+
+enum WiFiConnEvent : uint8_t {
+  WIFI_CONN_EVENT_NONE,
+  WIFI_CONN_EVENT_CONNECTED,       // Link is up (first connect or reconnect)
+  WIFI_CONN_EVENT_DROPPED,         // Link lost; reconnecting already started
+  WIFI_CONN_EVENT_ATTEMPT_FAILED,  // Scan connect timed out; backing off
+};
+
+// Everything needed to rejoin the last good network without a scan.
+struct WiFiFastConnectCache {
+  bool valid;
+  char ssid[33];
+  uint8_t bssid[6];
+  int32_t channel;
+};
+
+class WiFiRadio {
+ public:
+  virtual ~WiFiRadio() {}
+  // Starts connecting. cache is null for a cold connect with a full scan.
+  virtual void begin(const char* ssid, const char* password, const WiFiFastConnectCache* cache) = 0;
+  virtual void disconnect() = 0;
+  virtual bool isConnected() = 0;
+  // Why the link went down or the attempt is failing, as reported by the
+  // radio since the last begin(); 0 if unknown.
+  virtual uint8_t failureReason() = 0;
+  // Fills BSSID and channel of the current link.
+  virtual void readLink(WiFiFastConnectCache& cache) = 0;
+};
+
+class WiFiConnectionManager {
+ public:
+  explicit WiFiConnectionManager(WiFiRadio& radio) : radio_(radio) {}
+
+  void setCache(const WiFiFastConnectCache& cache) { cache_ = cache; }
+  const WiFiFastConnectCache& cache() const { return cache_; }
+  void seedJitter(uint32_t seed) { rng_ = seed ? seed : 1; }
+
+  void connect(const char* ssid, const char* password, unsigned long now);
+  void disconnect();
+  // Call regularly from loop(); returns what happened during this step.
+  WiFiConnEvent update(unsigned long now);
+
+  WiFiConnState state() const { return state_; }
+  bool isConnecting() const {
+    return state_ == WIFI_CONN_FAST || state_ == WIFI_CONN_SCAN || state_ == WIFI_CONN_BACKOFF;
+  }
+  unsigned long backoffDelay() const { return backoffDelay_; }
+  uint32_t failures() const { return failures_; }
+  uint32_t reconnects() const { return reconnects_; }
+  uint32_t fastConnects() const { return fastConnects_; }
+  uint32_t scanConnects() const { return scanConnects_; }
+  // Radio failure reason captured before the last drop or failed attempt
+  // was torn down.
+  uint8_t lastFailureReason() const { return lastFailureReason_; }
+
+  // Nearest-rank percentile (0-100) of recent connect times in ms, measured
+  // from the connect request or link loss until the link is up. 0 if none.
+  uint32_t connectTimePercentile(unsigned pct) const;
+  size_t connectTimeSamples() const { return sampleCount_; }
+  uint32_t lastConnectTime() const {
+    return sampleCount_ ? samples_[(sampleHead_ + WIFI_CONNECT_SAMPLES - 1) % WIFI_CONNECT_SAMPLES] : 0;
+  }
+
+ private:
+  void startAttempt(unsigned long now);
+  void startScan(unsigned long now);
+  void recordConnectTime(uint32_t ms);
+  uint32_t nextRandom();
+
+  WiFiRadio& radio_;
+  WiFiFastConnectCache cache_ = {};
+  char ssid_[33] = "";
+  char password_[65] = "";
+  WiFiConnState state_ = WIFI_CONN_IDLE;
+  unsigned long cycleStart_ = 0;    // Connect request or link loss
+  unsigned long attemptStart_ = 0;  // Current FAST/SCAN attempt or backoff
+  unsigned long backoffDelay_ = 0;
+  uint32_t failures_ = 0;  // Consecutive failed attempts in this cycle
+  uint32_t reconnects_ = 0;
+  uint32_t fastConnects_ = 0;
+  uint32_t scanConnects_ = 0;
+  uint8_t lastFailureReason_ = 0;
+  uint32_t rng_ = 1;
+  uint32_t samples_[WIFI_CONNECT_SAMPLES] = {};
+  size_t sampleCount_ = 0;
+  size_t sampleHead_ = 0;
+};
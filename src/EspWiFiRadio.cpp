@@ -0,0 +1,44 @@
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "EspWiFiRadio.h"
+
+void EspWiFiRadio::begin(const char* ssid, const char* password, const WiFiFastConnectCache* cache) {
+  if (!eventsRegistered_) {
+    eventsRegistered_ = true;
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+      // Our own disconnect() reports ASSOC_LEAVE; keep the real cause instead
+      uint8_t reason = info.wifi_sta_disconnected.reason;
+      if (reason != WIFI_REASON_ASSOC_LEAVE) {
+        disconnectReason_ = reason;
+      }
+    }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  }
+  disconnectReason_ = 0;
+
+  WiFi.mode(WIFI_AP_STA);
+
+  if (cache) {
+    // BSSID and channel skip the full scan; DHCP still assigns the address
+    WiFi.begin(ssid, password, cache->channel, cache->bssid);
+  } else {
+    WiFi.begin(ssid, password);
+  }
+}
+
+void EspWiFiRadio::disconnect() {
+  // Keep the station interface up, unlike WiFi.disconnect(true)
+  WiFi.disconnect(false);
+}
+
+bool EspWiFiRadio::isConnected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+void EspWiFiRadio::readLink(WiFiFastConnectCache& cache) {
+  uint8_t* bssid = WiFi.BSSID();
+  if (bssid) {
+    memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+  }
+  cache.channel = WiFi.channel();
+}
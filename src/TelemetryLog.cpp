@@ -0,0 +1,321 @@
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <esp_system.h>
+#include <time.h>
+
+#include "TelemetryLog.h"
+
+// Records are batched in RAM and written when the timer expires or the queue
+// is half full, so normal operation costs one flash write per minute at most.
+const unsigned long TLOG_FLUSH_INTERVAL_MS = 60000;
+const size_t TLOG_QUEUE_SIZE = 32;
+
+struct PendingRecord {
+  uint32_t time;
+  uint8_t type;
+  uint8_t aux;
+  int32_t value;
+};
+
+static bool tlog_ready = false;
+static PendingRecord tlog_queue[TLOG_QUEUE_SIZE];
+static size_t tlog_queue_count = 0;
+static uint32_t tlog_dropped = 0;
+static unsigned long tlog_last_flush = 0;
+static portMUX_TYPE tlog_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Current (newest) segment
+static TelemetryRingWriter tlog_ring;
+
+static void segmentPath(uint8_t index, char* path, size_t len) {
+  snprintf(path, len, "/tlog_%u.bin", index);
+}
+
+static bool readSegmentHeader(File& f, TelemetrySegmentHeader& h) {
+  return f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && telemetryHeaderValid(h);
+}
+
+// Finds the newest segment and rebuilds the ring state from its records. A
+// full or torn segment (power loss mid-write) is left as is; the next append
+// then starts a new one.
+static void resumeNewestSegment() {
+  bool found = false;
+  uint8_t index = 0;
+  uint32_t seq = 0;
+  char path[20];
+  for (uint8_t i = 0; i < TLOG_SEGMENT_COUNT; i++) {
+    segmentPath(i, path, sizeof(path));
+    File f = LittleFS.open(path, FILE_READ);
+    if (!f) continue;
+    TelemetrySegmentHeader h;
+    if (readSegmentHeader(f, h) && (!found || h.seq > seq)) {
+      found = true;
+      index = i;
+      seq = h.seq;
+    }
+    f.close();
+  }
+  if (!found) return;
+
+  tlog_ring.index = index;
+  tlog_ring.seq = seq;
+  tlog_ring.records = TLOG_RECORDS_PER_SEGMENT;
+
+  segmentPath(index, path, sizeof(path));
+  File f = LittleFS.open(path, FILE_READ);
+  TelemetrySegmentHeader h;
+  if (!f || !readSegmentHeader(f, h)) return;
+
+  size_t body = f.size() - sizeof(h);
+  if (body % sizeof(TelemetryRecord) != 0) {
+    f.close();
+    return;
+  }
+
+  TelemetryDecoder decoder;
+  decoder.beginSegment(h);
+  TelemetryRecord rec;
+  while (f.read((uint8_t*)&rec, sizeof(rec)) == sizeof(rec)) {
+    decoder.apply(rec);
+  }
+  f.close();
+
+  tlog_ring.baseTime = h.baseTime;
+  tlog_ring.records = body / sizeof(TelemetryRecord);
+  tlog_ring.lastTime = decoder.time;
+}
+
+void telemetryLogBegin() {
+  if (!LittleFS.begin(true)) {
+    Serial.println("❌ LittleFS mount failed - telemetry log disabled");
+    return;
+  }
+
+  resumeNewestSegment();
+  tlog_ready = true;
+  tlog_last_flush = millis();
+
+  Serial.printf("Telemetry log: segment %u (seq %u), %u records\n",
+                tlog_ring.index, (unsigned)tlog_ring.seq, (unsigned)tlog_ring.records);
+
+  telemetryLogAppend(TLOG_REBOOT, (uint8_t)esp_reset_reason(), (int32_t)ESP.getFreeHeap());
+  telemetryLogFlush();
+}
+
+void telemetryLogAppend(TelemetryEvent type, uint8_t aux, int32_t value) {
+  if (!tlog_ready) return;
+
+  PendingRecord rec = {(uint32_t)time(nullptr), type, aux, value};
+  portENTER_CRITICAL(&tlog_mux);
+  if (tlog_queue_count < TLOG_QUEUE_SIZE) {
+    tlog_queue[tlog_queue_count++] = rec;
+  } else {
+    tlog_dropped++;
+  }
+  portEXIT_CRITICAL(&tlog_mux);
+}
+
+void telemetryLogFlush() {
+  if (!tlog_ready) return;
+  tlog_last_flush = millis();
+
+  PendingRecord batch[TLOG_QUEUE_SIZE];
+  size_t count;
+  portENTER_CRITICAL(&tlog_mux);
+  count = tlog_queue_count;
+  memcpy(batch, tlog_queue, count * sizeof(PendingRecord));
+  tlog_queue_count = 0;
+  portEXIT_CRITICAL(&tlog_mux);
+
+  if (count == 0) return;
+
+  char path[20];
+  File f;
+  for (size_t i = 0; i < count; i++) {
+    const PendingRecord& p = batch[i];
+    TelemetryRecord recs[2];
+    bool rotated;
+    size_t n = tlog_ring.append(p.time, p.type, p.aux, p.value, recs, rotated);
+
+    if (rotated) {
+      if (f) f.close();
+      segmentPath(tlog_ring.index, path, sizeof(path));
+      f = LittleFS.open(path, FILE_WRITE);
+      if (f) {
+        TelemetrySegmentHeader h = tlog_ring.header();
+        f.write((const uint8_t*)&h, sizeof(h));
+      }
+    } else if (!f) {
+      segmentPath(tlog_ring.index, path, sizeof(path));
+      f = LittleFS.open(path, FILE_APPEND);
+    }
+    if (!f) {
+      // Count this record and the rest of the batch as lost
+      portENTER_CRITICAL(&tlog_mux);
+      tlog_dropped += count - i;
+      portEXIT_CRITICAL(&tlog_mux);
+      // The delta chain on flash is broken now; restart it in a new segment
+      tlog_ring.records = TLOG_RECORDS_PER_SEGMENT;
+      Serial.println("❌ Telemetry log: cannot open segment for append");
+      break;
+    }
+
+    f.write((const uint8_t*)recs, n * sizeof(TelemetryRecord));
+  }
+  if (f) f.close();
+
+  if (tlog_dropped > 0) {
+    Serial.printf("⚠️ Telemetry log: %u records dropped\n", (unsigned)tlog_dropped);
+    portENTER_CRITICAL(&tlog_mux);
+    tlog_dropped = 0;
+    portEXIT_CRITICAL(&tlog_mux);
+  }
+}
+
+void telemetryLogHandle() {
+  if (!tlog_ready) return;
+  if (tlog_queue_count >= TLOG_QUEUE_SIZE / 2 ||
+      (tlog_queue_count > 0 && millis() - tlog_last_flush >= TLOG_FLUSH_INTERVAL_MS)) {
+    telemetryLogFlush();
+  }
+}
+
+TelemetryLogReader::TelemetryLogReader(bool csv) : csv_(csv) {
+  // Snapshot the ring order; segments rotated away while streaming are cut off
+  // at the point the rotation is noticed (see readSegment())
+  char path[20];
+  for (uint8_t i = 0; i < TLOG_SEGMENT_COUNT; i++) {
+    segmentPath(i, path, sizeof(path));
+    File f = LittleFS.open(path, FILE_READ);
+    if (!f) continue;
+    TelemetrySegmentHeader h;
+    if (readSegmentHeader(f, h)) {
+      // Insertion sort by sequence number, oldest first
+      size_t pos = segmentCount_;
+      while (pos > 0 && seqs_[pos - 1] > h.seq) {
+        order_[pos] = order_[pos - 1];
+        seqs_[pos] = seqs_[pos - 1];
+        pos--;
+      }
+      order_[pos] = i;
+      seqs_[pos] = h.seq;
+      segmentCount_++;
+    }
+    f.close();
+  }
+}
+
+// Moves to the next segment that still carries the expected sequence number.
+bool TelemetryLogReader::openSegment() {
+  char path[20];
+  while (segmentPos_ < segmentCount_) {
+    segmentPath(order_[segmentPos_], path, sizeof(path));
+    File f = LittleFS.open(path, FILE_READ);
+    TelemetrySegmentHeader h;
+    bool ok = f && readSegmentHeader(f, h) && h.seq == seqs_[segmentPos_];
+    if (ok) {
+      // Stop at the last whole record so a torn write cannot shift the
+      // following segments off the record grid
+      size_t size = f.size();
+      decoder_.beginSegment(h);
+      offset_ = csv_ ? sizeof(h) : 0;
+      end_ = size - (size - sizeof(h)) % sizeof(TelemetryRecord);
+      segmentOpen_ = true;
+      f.close();
+      return true;
+    }
+    if (f) f.close();
+    segmentPos_++;
+  }
+  return false;
+}
+
+// Reads the next bytes of the current segment. Each chunk reopens the file, so
+// the header is checked before and after the read: a flush may have rotated
+// into this slot in the meantime, and its records must not be streamed under
+// the old header. Returns 0 at the end of the segment or once it was replaced.
+size_t TelemetryLogReader::readSegment(uint8_t* buf, size_t maxLen) {
+  if (offset_ >= end_) return 0;
+
+  char path[20];
+  segmentPath(order_[segmentPos_], path, sizeof(path));
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f) return 0;
+
+  size_t n = 0;
+  TelemetrySegmentHeader h;
+  if (readSegmentHeader(f, h) && h.seq == seqs_[segmentPos_] && f.seek(offset_)) {
+    n = f.read(buf, min(maxLen, end_ - offset_));
+    if (!f.seek(0) || !readSegmentHeader(f, h) || h.seq != seqs_[segmentPos_]) {
+      n = 0;
+    }
+  }
+  f.close();
+  return n;
+}
+
+size_t TelemetryLogReader::readRaw(uint8_t* buf, size_t maxLen) {
+  while (segmentOpen_ || openSegment()) {
+    size_t n = readSegment(buf, maxLen);
+    if (n > 0) {
+      offset_ += n;
+      return n;
+    }
+    segmentOpen_ = false;
+    segmentPos_++;
+  }
+  return 0;
+}
+
+bool TelemetryLogReader::nextRecord(TelemetryRecord& rec) {
+  while (recordPos_ == recordCount_) {
+    if (!segmentOpen_ && !openSegment()) return false;
+
+    size_t n = readSegment((uint8_t*)records_, sizeof(records_));
+    recordCount_ = n / sizeof(TelemetryRecord);
+    recordPos_ = 0;
+    offset_ += recordCount_ * sizeof(TelemetryRecord);
+    if (recordCount_ == 0) {
+      segmentOpen_ = false;
+      segmentPos_++;
+    }
+  }
+  rec = records_[recordPos_++];
+  return true;
+}
+
+bool TelemetryLogReader::nextLine() {
+  if (!headerSent_) {
+    headerSent_ = true;
+    lineLen_ = snprintf(line_, sizeof(line_), "seq,time,event,aux,value\n");
+    linePos_ = 0;
+    return true;
+  }
+
+  TelemetryRecord rec;
+  while (nextRecord(rec)) {
+    uint32_t t = decoder_.apply(rec);
+    if (rec.type == TLOG_TIME_BASE) continue;  // Encoding detail only
+    lineLen_ = snprintf(line_, sizeof(line_), "%u,%u,%s,%u,%d\n",
+                        (unsigned)seqs_[segmentPos_], (unsigned)t,
+                        telemetryEventName(rec.type), rec.aux, (int)rec.value);
+    linePos_ = 0;
+    return true;
+  }
+  return false;
+}
+
+size_t TelemetryLogReader::read(uint8_t* buf, size_t maxLen) {
+  if (!csv_) return readRaw(buf, maxLen);
+
+  size_t n = 0;
+  while (n < maxLen) {
+    if (linePos_ == lineLen_ && !nextLine()) break;
+    size_t chunk = min(maxLen - n, lineLen_ - linePos_);
+    memcpy(buf + n, line_ + linePos_, chunk);
+    linePos_ += chunk;
+    n += chunk;
+  }
+  return n;
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "WiFiConnectionManager.h"
+
+void WiFiConnectionManager::connect(const char* ssid, const char* password, unsigned long now) {
+  strncpy(ssid_, ssid, sizeof(ssid_) - 1);
+  ssid_[sizeof(ssid_) - 1] = '\0';
+  strncpy(password_, password, sizeof(password_) - 1);
+  password_[sizeof(password_) - 1] = '\0';
+
+  // A cache for another network is useless
+  if (strcmp(cache_.ssid, ssid_) != 0) {
+    cache_.valid = false;
+  }
+
+  radio_.disconnect();
+  failures_ = 0;
+  cycleStart_ = now;
+  startAttempt(now);
+}
+
+void WiFiConnectionManager::disconnect() {
+  radio_.disconnect();
+  state_ = WIFI_CONN_IDLE;
+}
+
+WiFiConnEvent WiFiConnectionManager::update(unsigned long now) {
+  switch (state_) {
+    case WIFI_CONN_IDLE:
+      return WIFI_CONN_EVENT_NONE;
+
+    case WIFI_CONN_FAST:
+    case WIFI_CONN_SCAN:
+      if (radio_.isConnected()) {
+        if (state_ == WIFI_CONN_FAST) {
+          fastConnects_++;
+        } else {
+          scanConnects_++;
+        }
+        radio_.readLink(cache_);
+        strcpy(cache_.ssid, ssid_);
+        cache_.valid = true;
+        recordConnectTime(now - cycleStart_);
+        failures_ = 0;
+        state_ = WIFI_CONN_CONNECTED;
+        return WIFI_CONN_EVENT_CONNECTED;
+      }
+      if (state_ == WIFI_CONN_FAST) {
+        if (now - attemptStart_ >= WIFI_FAST_CONNECT_TIMEOUT_MS) {
+          // AP gone or moved channel; fall back to a full scan right away
+          startScan(now);
+        }
+        return WIFI_CONN_EVENT_NONE;
+      }
+      if (now - attemptStart_ >= WIFI_SCAN_CONNECT_TIMEOUT_MS) {
+        lastFailureReason_ = radio_.failureReason();
+        radio_.disconnect();
+        failures_++;
+        // Exponential backoff with "equal jitter": half fixed, half random
+        unsigned long window = WIFI_BACKOFF_MAX_MS;
+        if (failures_ <= 16) {
+          window = WIFI_BACKOFF_BASE_MS << (failures_ - 1);
+          if (window > WIFI_BACKOFF_MAX_MS) window = WIFI_BACKOFF_MAX_MS;
+        }
+        backoffDelay_ = window / 2 + nextRandom() % (window / 2 + 1);
+        attemptStart_ = now;
+        state_ = WIFI_CONN_BACKOFF;
+        return WIFI_CONN_EVENT_ATTEMPT_FAILED;
+      }
+      return WIFI_CONN_EVENT_NONE;
+
+    case WIFI_CONN_BACKOFF:
+      if (now - attemptStart_ >= backoffDelay_) {
+        startAttempt(now);
+      }
+      return WIFI_CONN_EVENT_NONE;
+
+    case WIFI_CONN_CONNECTED:
+      if (!radio_.isConnected()) {
+        reconnects_++;
+        failures_ = 0;
+        cycleStart_ = now;
+        lastFailureReason_ = radio_.failureReason();
+        radio_.disconnect();
+        startAttempt(now);
+        return WIFI_CONN_EVENT_DROPPED;
+      }
+      return WIFI_CONN_EVENT_NONE;
+  }
+  return WIFI_CONN_EVENT_NONE;
+}
+
+void WiFiConnectionManager::startAttempt(unsigned long now) {
+  if (cache_.valid) {
+    state_ = WIFI_CONN_FAST;
+    attemptStart_ = now;
+    radio_.begin(ssid_, password_, &cache_);
+  } else {
+    startScan(now);
+  }
+}
+
+void WiFiConnectionManager::startScan(unsigned long now) {
+  if (state_ == WIFI_CONN_FAST) {
+    radio_.disconnect();
+  }
+  state_ = WIFI_CONN_SCAN;
+  attemptStart_ = now;
+  radio_.begin(ssid_, password_, nullptr);
+}
+
+void WiFiConnectionManager::recordConnectTime(uint32_t ms) {
+  samples_[sampleHead_] = ms;
+  sampleHead_ = (sampleHead_ + 1) % WIFI_CONNECT_SAMPLES;
+  if (sampleCount_ < WIFI_CONNECT_SAMPLES) sampleCount_++;
+}
+
+uint32_t WiFiConnectionManager::connectTimePercentile(unsigned pct) const {
+  if (sampleCount_ == 0) return 0;
+  if (pct > 100) pct = 100;
+
+  uint32_t sorted[WIFI_CONNECT_SAMPLES];
+  for (size_t i = 0; i < sampleCount_; i++) {
+    uint32_t v = samples_[i];
+    size_t j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+
+  size_t rank = (pct * sampleCount_ + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+uint32_t WiFiConnectionManager::nextRandom() {
+  // xorshift32; seeded from the hardware RNG on the device
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_;
+}
@@ -2,7 +2,13 @@
 #include <TFT_eSPI.h>
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
+#include <Preferences.h>
 #include <time.h>
+#include <esp_sntp.h>
+#include <memory>
+#include "TelemetryLog.h"
+#include "EspWiFiRadio.h"
+#include "WiFiConnectionManager.h"
 
 // put function declarations here:
 void drawDigitalClock(int h, int m, int s);
@@ -13,10 +19,16 @@ void setupWiFi();
 void setupWebServer();
 void connectToWiFi(const char* ssid, const char* password);
 void handleWiFiConnection(); // New async handler
+void loadWiFiSettings();
+void saveWiFiSettings();
+void forgetWiFiSettings();
 void syncTimeFromNTP();
+void onNtpTimeSync(struct timeval *tv);
+void applyNtpTime();
 String getHtmlPage();
 bool isLeapYear(int y);
 int getDaysInMonth(int y, int mo);
+long clockToEpoch(int y, int mo, int d, int h, int m, int s);
 
 TFT_eSPI tft = TFT_eSPI();
 unsigned long lastUpdate = 0;
@@ -35,6 +47,12 @@ const int TIME_INCREMENT_SECONDS = max(1, (int)(DISPLAY_REFRESH_TIME / 1000UL));
 int hours = 12, minutes = 0, seconds = 0;
 int year = 2025, month = 9, day = 13;  // Default date
 
+// Whether the clock above has been set since boot (NTP or /settime), and the
+// UTC offset its local time was set in. Drift is only measured against a
+// clock that was actually set, and in UTC so timezone changes do not count.
+bool clock_set = false;
+long clock_set_utc_offset_sec = 0;
+
 // Previous values for change detection
 int prevHours = -1, prevMinutes = -1, prevSeconds = -1;
 int prevYear = -1, prevMonth = -1, prevDay = -1;
@@ -49,10 +67,15 @@ String wifi_ssid = "";
 String wifi_password = "";
 bool wifi_connected = false;
 bool ntp_synced = false;
+volatile bool ntp_time_received = false;  // Set by the SNTP task, applied in loop()
 bool wifi_connect_requested = false;
-unsigned long wifi_connect_start = 0;
+bool wifi_disconnect_requested = false;
 bool wifi_connecting = false;
 
+// Station connection state machine (fast connect, scan fallback, backoff)
+EspWiFiRadio wifiRadio;
+WiFiConnectionManager wifiManager(wifiRadio);
+
 // Timezone settings (can be configured via web interface)
 long current_gmt_offset_sec = -25200;  // Default to PDT (-7 hours)
 int current_daylight_offset_sec = 0;   // Included in gmt_offset_sec
@@ -81,6 +104,9 @@ void setup() {
   Serial.println(" seconds");
   Serial.println("-------------------------------------------");
   
+  // Open the on-flash telemetry log and record this boot
+  telemetryLogBegin();
+  
   // Initialize TFT display
   tft.init();
   tft.setRotation(1); // Landscape
@@ -95,6 +121,9 @@ void setup() {
   // Setup Access Point and Web Server
   Serial.println("Setting up WiFi Access Point...");
   setupWiFi();
+  sntp_set_time_sync_notification_cb(onNtpTimeSync);
+  wifiManager.seedJitter(esp_random());
+  loadWiFiSettings();
   Serial.println("Setting up Web Server...");
   setupWebServer();
   
@@ -115,6 +144,7 @@ void setup() {
 void loop() {
   // put your main code here, to run repeatedly:
   static unsigned long lastHeartbeat = 0;
+  static uint32_t loggedHeapLow = UINT32_MAX;
   
   // Prevent watchdog reset
   yield();
@@ -122,6 +152,15 @@ void loop() {
   // Handle WiFi connection asynchronously
   handleWiFiConnection();
   
+  // Copy a freshly synced NTP time into the clock
+  if (ntp_time_received) {
+    ntp_time_received = false;
+    applyNtpTime();
+  }
+  
+  // Write batched telemetry records to flash when due
+  telemetryLogHandle();
+  
   // Heartbeat every 10 seconds to show ESP32 is alive
   if (millis() - lastHeartbeat >= 10000) {
     lastHeartbeat = millis();
@@ -132,6 +171,13 @@ void loop() {
     Serial.print(", Free RAM: ");
     Serial.print(ESP.getFreeHeap());
     Serial.println(" bytes");
+    
+    // Log the heap low-water mark when it drops by at least 1 KB
+    uint32_t heapLow = ESP.getMinFreeHeap();
+    if (heapLow + 1024 <= loggedHeapLow) {
+      loggedHeapLow = heapLow;
+      telemetryLogAppend(TLOG_HEAP_LOW, 0, (int32_t)heapLow);
+    }
   }
   
   if (millis() - lastUpdate >= CLOCK_UPDATE_INTERVAL) {
@@ -266,9 +312,24 @@ int getDaysInMonth(int y, int mo) {
   return daysInMonth[mo - 1];
 }
 
+long clockToEpoch(int y, int mo, int d, int h, int m, int s) {
+  // Seconds since 1970-01-01 for a proleptic Gregorian date (days-from-civil)
+  y -= mo <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  long yoe = y - era * 400;
+  long doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  long days = era * 146097 + doe - 719468;
+  return days * 86400 + h * 3600L + m * 60L + s;
+}
+
 void setupWiFi() {
   // Start Access Point mode
   Serial.println("Starting Access Point...");
+  // Must come before the driver starts: keep station configs out of NVS (the
+  // connection manager changes them on every attempt) and leave retries to it
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
   WiFi.softAP(ap_ssid, ap_password);
   IPAddress apIP = WiFi.softAPIP();
   Serial.print("AP IP address: ");
@@ -284,9 +345,16 @@ void setupWiFi() {
 }
 
 void handleWiFiConnection() {
-  // Handle async WiFi connection process
-  if (wifi_connect_requested && !wifi_connecting) {
-    // Start WiFi connection process
+  // Apply requests queued by the web server
+  if (wifi_disconnect_requested) {
+    wifi_disconnect_requested = false;
+    wifi_connect_requested = false;
+    wifiManager.disconnect();
+    forgetWiFiSettings();
+    Serial.println("Disconnected from WiFi");
+  }
+  if (wifi_connect_requested) {
+    wifi_connect_requested = false;
     Serial.println();
     Serial.println("🌐 === Starting Async WiFi Connection ===");
     Serial.print("SSID: '");
@@ -294,59 +362,61 @@ void handleWiFiConnection() {
     Serial.print("' (length: ");
     Serial.print(wifi_ssid.length());
     Serial.println(")");
-    
-    // Disconnect and setup
-    WiFi.disconnect(true);
-    WiFi.mode(WIFI_AP_STA);
-    
-    // Start connection
-    Serial.println("Starting WiFi connection (async)...");
-    WiFi.begin(wifi_ssid.c_str(), wifi_password.c_str());
-    
-    wifi_connecting = true;
-    wifi_connect_start = millis();
-    wifi_connect_requested = false;
-    Serial.println("WiFi connection initiated - monitoring in background...");
+    Serial.println(wifiManager.cache().valid && wifi_ssid == wifiManager.cache().ssid
+                       ? "Trying fast connect with cached BSSID/channel..."
+                       : "Starting WiFi connection with full scan...");
+    wifiManager.connect(wifi_ssid.c_str(), wifi_password.c_str(), millis());
   }
   
-  // Monitor ongoing connection
-  if (wifi_connecting) {
-    static unsigned long lastStatusCheck = 0;
-    
-    // Check status every 1 second
-    if (millis() - lastStatusCheck >= 1000) {
-      lastStatusCheck = millis();
-      wl_status_t status = WiFi.status();
+  WiFiConnState prevState = wifiManager.state();
+  WiFiConnEvent event = wifiManager.update(millis());
+  
+  switch (event) {
+    case WIFI_CONN_EVENT_CONNECTED:
+      wifi_connected = true;
+      Serial.print("✅ WiFi connected successfully in ");
+      Serial.print(wifiManager.lastConnectTime());
+      Serial.println(prevState == WIFI_CONN_FAST ? " ms (fast connect)" : " ms (scan)");
+      Serial.print("📍 IP address: ");
+      Serial.println(WiFi.localIP());
+      Serial.print("📶 Signal strength: ");
+      Serial.print(WiFi.RSSI());
+      Serial.println(" dBm");
       
-      Serial.print("WiFi Status: ");
-      Serial.print(status);
-      Serial.print(" (");
-      Serial.print((millis() - wifi_connect_start) / 1000);
-      Serial.println("s)");
+      saveWiFiSettings();
       
-      if (status == WL_CONNECTED) {
-        wifi_connected = true;
-        wifi_connecting = false;
-        Serial.println("✅ WiFi connected successfully!");
-        Serial.print("📍 IP address: ");
-        Serial.println(WiFi.localIP());
-        Serial.print("📶 Signal strength: ");
-        Serial.print(WiFi.RSSI());
-        Serial.println(" dBm");
-        
-        // Sync time from NTP
-        syncTimeFromNTP();
-        
-      } else if (millis() - wifi_connect_start >= 20000) {
-        // Timeout after 20 seconds
-        wifi_connecting = false;
-        wifi_connected = false;
-        Serial.println("❌ WiFi connection timeout!");
-        Serial.print("Final status: ");
-        Serial.println(status);
-      }
-    }
+      // Resync time from NTP after every (re)connect
+      syncTimeFromNTP();
+      break;
+      
+    case WIFI_CONN_EVENT_DROPPED:
+      wifi_connected = false;
+      ntp_synced = false;
+      Serial.print("⚠️ WiFi connection lost, reason: ");
+      Serial.print(wifiManager.lastFailureReason());
+      Serial.println(" - reconnecting...");
+      telemetryLogAppend(TLOG_WIFI_DROP, wifiManager.lastFailureReason(), 0);
+      break;
+      
+    case WIFI_CONN_EVENT_ATTEMPT_FAILED:
+      Serial.print("❌ WiFi connection timeout (reason ");
+      Serial.print(wifiManager.lastFailureReason());
+      Serial.print(")! Retry ");
+      Serial.print(wifiManager.failures());
+      Serial.print(" in ");
+      Serial.print(wifiManager.backoffDelay());
+      Serial.println(" ms");
+      telemetryLogAppend(TLOG_WIFI_DROP, wifiManager.lastFailureReason(), 1);
+      break;
+      
+    default:
+      break;
+  }
+  
+  if (wifiManager.state() == WIFI_CONN_SCAN && prevState == WIFI_CONN_FAST) {
+    Serial.println("Fast connect failed - falling back to full scan...");
   }
+  wifi_connecting = wifiManager.isConnecting();
 }
 
 void connectToWiFi(const char* ssid, const char* password) {
@@ -355,11 +425,63 @@ void connectToWiFi(const char* ssid, const char* password) {
   wifi_password = String(password);
   wifi_connect_requested = true;
   wifi_connected = false;
-  wifi_connecting = false;
+  wifi_connecting = true;
   
   Serial.println("WiFi connection request queued for async processing...");
 }
 
+void loadWiFiSettings() {
+  // Restore the last good network and its fast-connect cache
+  Preferences prefs;
+  if (!prefs.begin("wifi", true)) {
+    return;
+  }
+  String ssid = prefs.getString("ssid", "");
+  String password = prefs.getString("pass", "");
+  WiFiFastConnectCache cache = {};
+  if (prefs.getBytesLength("cache") == sizeof(cache)) {
+    prefs.getBytes("cache", &cache, sizeof(cache));
+    wifiManager.setCache(cache);
+  }
+  prefs.end();
+  
+  if (ssid.length() > 0) {
+    Serial.println("Reconnecting to saved WiFi: " + ssid);
+    connectToWiFi(ssid.c_str(), password.c_str());
+  }
+}
+
+void saveWiFiSettings() {
+  // Only write to NVS when something changed to spare the flash
+  Preferences prefs;
+  if (!prefs.begin("wifi", false)) {
+    return;
+  }
+  const WiFiFastConnectCache& cache = wifiManager.cache();
+  WiFiFastConnectCache stored = {};
+  bool cacheChanged = prefs.getBytes("cache", &stored, sizeof(stored)) != sizeof(stored) ||
+                      memcmp(&stored, &cache, sizeof(cache)) != 0;
+  if (cacheChanged) {
+    prefs.putBytes("cache", &cache, sizeof(cache));
+  }
+  if (prefs.getString("ssid", "") != wifi_ssid) {
+    prefs.putString("ssid", wifi_ssid);
+  }
+  if (prefs.getString("pass", "") != wifi_password) {
+    prefs.putString("pass", wifi_password);
+  }
+  prefs.end();
+}
+
+void forgetWiFiSettings() {
+  Preferences prefs;
+  if (prefs.begin("wifi", false)) {
+    prefs.clear();
+    prefs.end();
+  }
+  wifiManager.setCache(WiFiFastConnectCache{});
+}
+
 void syncTimeFromNTP() {
   if (!wifi_connected) {
     Serial.println("Cannot sync time: WiFi not connected");
@@ -371,28 +493,52 @@ void syncTimeFromNTP() {
   Serial.print(current_gmt_offset_sec);
   Serial.println(" seconds from UTC");
   
-  // Configure NTP with current timezone settings (non-blocking)
-  configTime(current_gmt_offset_sec, current_daylight_offset_sec, ntp_server);
+  telemetryLogAppend(TLOG_NTP_RESYNC, 0, (int32_t)current_gmt_offset_sec);
   
-  // Try to get time immediately (non-blocking)
+  // Configure NTP with current timezone settings (non-blocking). The clock
+  // is updated from onNtpTimeSync() once a server has actually answered.
+  ntp_synced = false;
+  configTime(current_gmt_offset_sec, current_daylight_offset_sec, ntp_server);
+  Serial.println("⏳ NTP sync initiated - time will update automatically when ready");
+}
+
+void onNtpTimeSync(struct timeval *tv) {
+  // Runs in the SNTP task on every completed sync, including periodic ones
+  if (!wifi_connected) {
+    return;
+  }
+  ntp_synced = true;
+  ntp_time_received = true;
+}
+
+void applyNtpTime() {
   struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
-    // Update internal clock variables
-    hours = timeinfo.tm_hour;
-    minutes = timeinfo.tm_min;
-    seconds = timeinfo.tm_sec;
-    year = timeinfo.tm_year + 1900;
-    month = timeinfo.tm_mon + 1;
-    day = timeinfo.tm_mday;
-    
-    ntp_synced = true;
-    Serial.println("✅ Time synchronized from NTP to local timezone!");
-    Serial.printf("Local time: %04d-%02d-%02d %02d:%02d:%02d\n", 
-                 year, month, day, hours, minutes, seconds);
-  } else {
-    Serial.println("⏳ NTP sync initiated - time will update automatically when ready");
-    ntp_synced = false;
+  if (!getLocalTime(&timeinfo, 0)) {
+    return;
+  }
+  
+  // Record how far the internal clock had drifted from NTP, compared in UTC
+  long ntpOffset = current_gmt_offset_sec + current_daylight_offset_sec;
+  if (clock_set) {
+    long ntpUtc = clockToEpoch(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+                               timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec) - ntpOffset;
+    long clockUtc = clockToEpoch(year, month, day, hours, minutes, seconds) - clock_set_utc_offset_sec;
+    telemetryLogAppend(TLOG_NTP_OFFSET, 0, (int32_t)(ntpUtc - clockUtc));
   }
+  
+  // Update internal clock variables
+  hours = timeinfo.tm_hour;
+  minutes = timeinfo.tm_min;
+  seconds = timeinfo.tm_sec;
+  year = timeinfo.tm_year + 1900;
+  month = timeinfo.tm_mon + 1;
+  day = timeinfo.tm_mday;
+  clock_set = true;
+  clock_set_utc_offset_sec = ntpOffset;
+  
+  Serial.println("✅ Time synchronized from NTP to local timezone!");
+  Serial.printf("Local time: %04d-%02d-%02d %02d:%02d:%02d\n", 
+               year, month, day, hours, minutes, seconds);
 }
 
 void setupWebServer() {
@@ -425,6 +571,18 @@ void setupWebServer() {
           newMonth >= 1 && newMonth <= 12 &&
           newDay >= 1 && newDay <= getDaysInMonth(newYear, newMonth)) {
         
+        // Manual time is entered in the current timezone; compare in UTC
+        long newOffset = current_gmt_offset_sec + current_daylight_offset_sec;
+        if (clock_set) {
+          long newUtc = clockToEpoch(newYear, newMonth, newDay, newHours, newMinutes, newSeconds) - newOffset;
+          long oldUtc = clockToEpoch(year, month, day, hours, minutes, seconds) - clock_set_utc_offset_sec;
+          telemetryLogAppend(TLOG_TIME_SET, 0, (int32_t)(newUtc - oldUtc));
+        } else {
+          telemetryLogAppend(TLOG_TIME_SET, 1, 0);
+        }
+        clock_set = true;
+        clock_set_utc_offset_sec = newOffset;
+        
         hours = newHours;
         minutes = newMinutes;
         seconds = newSeconds;
@@ -507,7 +665,13 @@ void setupWebServer() {
                        ",\"connection_status\":\"" + connectionStatus + "\"" +
                        ",\"ntp_synced\":" + String(ntp_synced ? "true" : "false") + 
                        ",\"ip_address\":\"" + (wifi_connected ? WiFi.localIP().toString() : "Not connected") + "\"" +
-                       ",\"timezone_offset\":" + String(current_gmt_offset_sec) + "}";
+                       ",\"timezone_offset\":" + String(current_gmt_offset_sec) +
+                       ",\"wifi_reconnects\":" + String(wifiManager.reconnects()) +
+                       ",\"wifi_fast_connects\":" + String(wifiManager.fastConnects()) +
+                       ",\"wifi_scan_connects\":" + String(wifiManager.scanConnects()) +
+                       ",\"connect_ms_p50\":" + String(wifiManager.connectTimePercentile(50)) +
+                       ",\"connect_ms_p90\":" + String(wifiManager.connectTimePercentile(90)) +
+                       ",\"connect_ms_max\":" + String(wifiManager.connectTimePercentile(100)) + "}";
     
     Serial.println("Status requested: " + statusJson);
     
@@ -521,11 +685,12 @@ void setupWebServer() {
   
   // Disconnect from WiFi
   server.on("/disconnectwifi", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (wifi_connected) {
-      WiFi.disconnect();
+    if (wifi_connected || wifi_connecting) {
+      // Handled in loop() so the connection manager does not treat it as a drop
+      wifi_disconnect_requested = true;
       wifi_connected = false;
+      wifi_connecting = false;
       ntp_synced = false;
-      Serial.println("Disconnected from WiFi");
       request->send(200, "text/plain", "Disconnected from WiFi successfully!");
     } else {
       request->send(400, "text/plain", "Not connected to WiFi!");
@@ -558,6 +723,21 @@ void setupWebServer() {
     }
   });
   
+  // Stream the telemetry log from flash: /log (CSV) or /log?format=bin (raw segments)
+  server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request){
+    bool csv = !(request->hasParam("format") && request->getParam("format")->value() == "bin");
+    std::shared_ptr<TelemetryLogReader> reader = std::make_shared<TelemetryLogReader>(csv);
+    
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        csv ? "text/csv" : "application/octet-stream",
+        [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+          return reader->read(buffer, maxLen);
+        });
+    response->addHeader("Content-Disposition", csv ? "attachment; filename=\"clock_log.csv\""
+                                                   : "attachment; filename=\"clock_log.bin\"");
+    request->send(response);
+  });
+  
   server.begin();
   Serial.println("Web server started");
 }
@@ -0,0 +1,184 @@
+#include <unity.h>
+#include <vector>
+
+#include "TelemetryLog.h"
+
+// Host-side model of the flash ring: one byte vector per segment file, written
+// the way telemetryLogFlush() writes them.
+struct FakeRing {
+  TelemetryRingWriter writer;
+  std::vector<uint8_t> files[TLOG_SEGMENT_COUNT];
+
+  void append(uint32_t time, uint8_t type, int32_t value) {
+    TelemetryRecord recs[2];
+    bool rotated;
+    size_t n = writer.append(time, type, 0, value, recs, rotated);
+    std::vector<uint8_t>& f = files[writer.index];
+    if (rotated) {
+      TelemetrySegmentHeader h = writer.header();
+      f.assign((const uint8_t*)&h, (const uint8_t*)&h + sizeof(h));
+    }
+    f.insert(f.end(), (const uint8_t*)recs, (const uint8_t*)recs + n * sizeof(TelemetryRecord));
+  }
+
+  // Files concatenated in slot order, which after wraparound is not seq order
+  std::vector<uint8_t> download() const {
+    std::vector<uint8_t> out;
+    for (const std::vector<uint8_t>& f : files) out.insert(out.end(), f.begin(), f.end());
+    return out;
+  }
+};
+
+struct Decoded {
+  uint32_t seq;
+  uint32_t time;
+  uint8_t type;
+  int32_t value;
+};
+
+static std::vector<Decoded> decodeDownload(const std::vector<uint8_t>& raw, size_t* segments = nullptr) {
+  TelemetrySegmentSpan spans[TLOG_SEGMENT_COUNT * 2];
+  size_t n = telemetrySplitSegments(raw.data(), raw.size(), spans, TLOG_SEGMENT_COUNT * 2);
+  if (segments) *segments = n;
+
+  std::vector<Decoded> out;
+  for (size_t s = 0; s < n; s++) {
+    TelemetryDecoder decoder;
+    decoder.beginSegment(spans[s].header);
+    for (size_t i = 0; i < spans[s].records; i++) {
+      TelemetryRecord r = telemetryRecordAt(raw.data(), spans[s], i);
+      uint32_t t = decoder.apply(r);
+      if (r.type != TLOG_TIME_BASE) {
+        out.push_back({spans[s].header.seq, t, r.type, r.value});
+      }
+    }
+  }
+  return out;
+}
+
+static size_t countType(const std::vector<uint8_t>& file, uint8_t type) {
+  size_t count = 0;
+  for (size_t pos = sizeof(TelemetrySegmentHeader); pos + sizeof(TelemetryRecord) <= file.size();
+       pos += sizeof(TelemetryRecord)) {
+    if (file[pos + 2] == type) count++;
+  }
+  return count;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_ring_wraparound_keeps_newest_segments() {
+  FakeRing ring;
+  std::vector<uint32_t> times;
+  uint32_t t = 100;
+  const int events = TLOG_RECORDS_PER_SEGMENT * (TLOG_SEGMENT_COUNT + 3) + 17;
+  for (int i = 0; i < events; i++) {
+    t += 7;
+    times.push_back(t);
+    ring.append(t, TLOG_HEAP_LOW, i);
+  }
+  TEST_ASSERT_TRUE(ring.writer.seq > TLOG_SEGMENT_COUNT);
+
+  size_t segments;
+  std::vector<Decoded> decoded = decodeDownload(ring.download(), &segments);
+  TEST_ASSERT_EQUAL(TLOG_SEGMENT_COUNT, segments);
+
+  // Exactly the newest events survive, in order and with their times
+  size_t kept = TLOG_RECORDS_PER_SEGMENT * (TLOG_SEGMENT_COUNT - 1) + 17;
+  TEST_ASSERT_EQUAL(kept, decoded.size());
+  for (size_t i = 0; i < kept; i++) {
+    int32_t value = events - kept + i;
+    TEST_ASSERT_EQUAL_INT32(value, decoded[i].value);
+    TEST_ASSERT_EQUAL_UINT32(times[value], decoded[i].time);
+  }
+  TEST_ASSERT_EQUAL_UINT32(ring.writer.seq - TLOG_SEGMENT_COUNT + 1, decoded.front().seq);
+  TEST_ASSERT_EQUAL_UINT32(ring.writer.seq, decoded.back().seq);
+}
+
+void test_time_going_backwards_writes_time_base() {
+  FakeRing ring;
+  ring.append(5000, TLOG_NTP_OFFSET, 1);
+  ring.append(3, TLOG_REBOOT, 2);  // Reboot before NTP: uptime restarts
+  ring.append(10, TLOG_WIFI_DROP, 3);
+
+  TEST_ASSERT_EQUAL(1, countType(ring.files[ring.writer.index], TLOG_TIME_BASE));
+  std::vector<Decoded> decoded = decodeDownload(ring.download());
+  TEST_ASSERT_EQUAL(3, decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(5000, decoded[0].time);
+  TEST_ASSERT_EQUAL_UINT32(3, decoded[1].time);
+  TEST_ASSERT_EQUAL_UINT32(10, decoded[2].time);
+}
+
+void test_gap_over_16_bits_writes_time_base() {
+  FakeRing ring;
+  ring.append(1000, TLOG_HEAP_LOW, 1);
+  ring.append(1000 + 0xFFFF, TLOG_HEAP_LOW, 2);  // Still fits in dt
+  TEST_ASSERT_EQUAL(0, countType(ring.files[ring.writer.index], TLOG_TIME_BASE));
+
+  ring.append(1700000000UL, TLOG_NTP_OFFSET, 3);  // NTP step to Unix time
+  TEST_ASSERT_EQUAL(1, countType(ring.files[ring.writer.index], TLOG_TIME_BASE));
+
+  std::vector<Decoded> decoded = decodeDownload(ring.download());
+  TEST_ASSERT_EQUAL(3, decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(1000 + 0xFFFF, decoded[1].time);
+  TEST_ASSERT_EQUAL_UINT32(1700000000UL, decoded[2].time);
+}
+
+void test_time_base_never_split_from_its_record() {
+  FakeRing ring;
+  uint32_t t = 0;
+  for (size_t i = 0; i < TLOG_RECORDS_PER_SEGMENT - 1; i++) {
+    ring.append(++t, TLOG_HEAP_LOW, 0);
+  }
+  // One slot left but the jump needs two records: starts a new segment
+  ring.append(t + 100000, TLOG_NTP_OFFSET, 42);
+  TEST_ASSERT_EQUAL_UINT32(2, ring.writer.seq);
+  TEST_ASSERT_EQUAL(1, ring.writer.records);
+
+  std::vector<Decoded> decoded = decodeDownload(ring.download());
+  TEST_ASSERT_EQUAL_UINT32(t + 100000, decoded.back().time);
+  TEST_ASSERT_EQUAL_INT32(42, decoded.back().value);
+}
+
+void test_split_orders_segments_by_seq() {
+  FakeRing ring;
+  for (size_t i = 0; i < TLOG_RECORDS_PER_SEGMENT * 3; i++) {
+    ring.append(i, TLOG_HEAP_LOW, i);
+  }
+  // Concatenate newest first
+  std::vector<uint8_t> raw;
+  for (int i = 2; i >= 0; i--) raw.insert(raw.end(), ring.files[i].begin(), ring.files[i].end());
+
+  TelemetrySegmentSpan spans[4];
+  size_t n = telemetrySplitSegments(raw.data(), raw.size(), spans, 4);
+  TEST_ASSERT_EQUAL(3, n);
+  for (size_t i = 0; i < n; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i + 1, spans[i].header.seq);
+    TEST_ASSERT_EQUAL(TLOG_RECORDS_PER_SEGMENT, spans[i].records);
+  }
+}
+
+void test_split_ignores_partial_trailing_record() {
+  FakeRing ring;
+  ring.append(1, TLOG_REBOOT, 0);
+  ring.append(2, TLOG_HEAP_LOW, 1000);
+  std::vector<uint8_t> raw = ring.download();
+  raw.push_back(0xAA);
+  raw.push_back(0xBB);
+
+  std::vector<Decoded> decoded = decodeDownload(raw);
+  TEST_ASSERT_EQUAL(2, decoded.size());
+  TEST_ASSERT_EQUAL_INT32(1000, decoded[1].value);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_wraparound_keeps_newest_segments);
+  RUN_TEST(test_time_going_backwards_writes_time_base);
+  RUN_TEST(test_gap_over_16_bits_writes_time_base);
+  RUN_TEST(test_time_base_never_split_from_its_record);
+  RUN_TEST(test_split_orders_segments_by_seq);
+  RUN_TEST(test_split_ignores_partial_trailing_record);
+  return UNITY_END();
+}
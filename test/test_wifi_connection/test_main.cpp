@@ -0,0 +1,236 @@
+#include <unity.h>
+#include <string.h>
+
+#include "WiFiConnectionManager.h"
+
+// Scripted radio: an attempt succeeds after fastMs (with cache) or scanMs
+// (cold) of simulated time; a negative value means it never does and the
+// attempt reports failWith as its failure reason.
+struct FakeRadio : WiFiRadio {
+  unsigned long now = 0;
+  long fastMs = -1;
+  long scanMs = -1;
+  uint8_t failWith = 0;
+
+  uint8_t reason = 0;
+
+  bool up = false;
+  bool trying = false;
+  bool lastBeginFast = false;
+  unsigned long began = 0;
+  int fastBegins = 0;
+  int scanBegins = 0;
+
+  void begin(const char* ssid, const char* password, const WiFiFastConnectCache* cache) override {
+    lastBeginFast = cache != nullptr;
+    if (lastBeginFast) {
+      fastBegins++;
+    } else {
+      scanBegins++;
+    }
+    began = now;
+    trying = true;
+    reason = (lastBeginFast ? fastMs : scanMs) < 0 ? failWith : 0;
+  }
+  void disconnect() override {
+    up = false;
+    trying = false;
+  }
+  bool isConnected() override {
+    long ms = lastBeginFast ? fastMs : scanMs;
+    if (trying && ms >= 0 && (long)(now - began) >= ms) {
+      up = true;
+      trying = false;
+    }
+    return up;
+  }
+  uint8_t failureReason() override { return reason; }
+  void readLink(WiFiFastConnectCache& cache) override {
+    memset(cache.bssid, 0xAB, sizeof(cache.bssid));
+    cache.channel = 6;
+  }
+
+  // Link loss as seen by the driver
+  void dropLink(uint8_t why) {
+    up = false;
+    reason = why;
+  }
+};
+
+static FakeRadio radio;
+static WiFiConnectionManager* manager;
+
+// Steps the state machine in 50 ms ticks until it reports `want` or
+// `timeoutMs` passes.
+static bool runUntil(WiFiConnEvent want, unsigned long timeoutMs) {
+  unsigned long end = radio.now + timeoutMs;
+  while (radio.now < end) {
+    radio.now += 50;
+    if (manager->update(radio.now) == want) return true;
+  }
+  return false;
+}
+
+static void connectCold() {
+  radio.scanMs = 3000;
+  manager->connect("office", "secret", radio.now);
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 10000));
+}
+
+void setUp() {
+  radio = FakeRadio();
+  manager = new WiFiConnectionManager(radio);
+  manager->seedJitter(12345);
+}
+
+void tearDown() {
+  delete manager;
+}
+
+void test_cold_connect_scans_and_fills_cache() {
+  manager->connect("office", "secret", radio.now);
+  TEST_ASSERT_EQUAL(WIFI_CONN_SCAN, manager->state());
+
+  radio.scanMs = 3000;
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 10000));
+  TEST_ASSERT_EQUAL(WIFI_CONN_CONNECTED, manager->state());
+  TEST_ASSERT_TRUE(manager->cache().valid);
+  TEST_ASSERT_EQUAL(6, manager->cache().channel);
+  TEST_ASSERT_EQUAL(0, strcmp(manager->cache().ssid, "office"));
+  TEST_ASSERT_EQUAL(1, manager->scanConnects());
+  TEST_ASSERT_UINT32_WITHIN(50, 3000, manager->lastConnectTime());
+}
+
+void test_fast_connect_uses_cache() {
+  connectCold();
+  manager->disconnect();
+
+  radio.fastMs = 300;
+  manager->connect("office", "secret", radio.now);
+  TEST_ASSERT_EQUAL(WIFI_CONN_FAST, manager->state());
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 2000));
+  TEST_ASSERT_EQUAL(1, manager->fastConnects());
+  TEST_ASSERT_EQUAL(1, radio.scanBegins);
+  TEST_ASSERT_UINT32_WITHIN(50, 300, manager->lastConnectTime());
+}
+
+void test_cache_ignored_for_other_ssid() {
+  connectCold();
+  manager->connect("lab", "secret", radio.now);
+  TEST_ASSERT_EQUAL(WIFI_CONN_SCAN, manager->state());
+  TEST_ASSERT_FALSE(manager->cache().valid);
+}
+
+void test_fast_connect_falls_back_to_scan() {
+  connectCold();
+  manager->disconnect();
+
+  radio.fastMs = -1;  // AP moved to another channel
+  radio.scanMs = 1000;
+  manager->connect("office", "secret", radio.now);
+  TEST_ASSERT_EQUAL(WIFI_CONN_FAST, manager->state());
+
+  radio.now += WIFI_FAST_CONNECT_TIMEOUT_MS;
+  TEST_ASSERT_EQUAL(WIFI_CONN_EVENT_NONE, manager->update(radio.now));
+  TEST_ASSERT_EQUAL(WIFI_CONN_SCAN, manager->state());
+
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 5000));
+  TEST_ASSERT_EQUAL(2, manager->scanConnects());
+  TEST_ASSERT_EQUAL(0, manager->fastConnects());
+  TEST_ASSERT_UINT32_WITHIN(50, WIFI_FAST_CONNECT_TIMEOUT_MS + 1000, manager->lastConnectTime());
+}
+
+void test_backoff_grows_with_jitter_and_is_capped() {
+  radio.scanMs = -1;
+  radio.failWith = 201;  // NO_AP_FOUND
+  manager->connect("office", "secret", radio.now);
+
+  unsigned long previous[12];
+  for (int i = 0; i < 12; i++) {
+    TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_ATTEMPT_FAILED, 200000));
+    TEST_ASSERT_EQUAL(201, manager->lastFailureReason());
+
+    unsigned long window = WIFI_BACKOFF_BASE_MS << i;
+    if (window > WIFI_BACKOFF_MAX_MS) window = WIFI_BACKOFF_MAX_MS;
+    unsigned long delay = manager->backoffDelay();
+    TEST_ASSERT_GREATER_OR_EQUAL(window / 2, delay);
+    TEST_ASSERT_LESS_OR_EQUAL(window, delay);
+    TEST_ASSERT_EQUAL(i + 1, manager->failures());
+    previous[i] = delay;
+
+    // No retry before the delay has passed
+    TEST_ASSERT_EQUAL(WIFI_CONN_BACKOFF, manager->state());
+    radio.now += delay - 1;
+    manager->update(radio.now);
+    TEST_ASSERT_EQUAL(WIFI_CONN_BACKOFF, manager->state());
+  }
+
+  // Jitter: the capped retries do not all wait the same time
+  bool varied = false;
+  for (int i = 8; i < 12; i++) {
+    if (previous[i] != previous[7]) varied = true;
+  }
+  TEST_ASSERT_TRUE(varied);
+
+  // Network back: reconnects and resets the failure count
+  radio.scanMs = 500;
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, WIFI_BACKOFF_MAX_MS + 5000));
+  TEST_ASSERT_EQUAL(0, manager->failures());
+}
+
+void test_reconnects_after_drop() {
+  connectCold();
+  radio.fastMs = 400;
+  radio.dropLink(15);  // 4WAY_HANDSHAKE_TIMEOUT
+
+  radio.now += 50;
+  TEST_ASSERT_EQUAL(WIFI_CONN_EVENT_DROPPED, manager->update(radio.now));
+  TEST_ASSERT_EQUAL(15, manager->lastFailureReason());
+  TEST_ASSERT_EQUAL(WIFI_CONN_FAST, manager->state());
+  TEST_ASSERT_TRUE(manager->isConnecting());
+
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 2000));
+  TEST_ASSERT_EQUAL(1, manager->reconnects());
+  TEST_ASSERT_EQUAL(1, manager->fastConnects());
+}
+
+void test_disconnect_stays_idle() {
+  connectCold();
+  manager->disconnect();
+  TEST_ASSERT_EQUAL(WIFI_CONN_IDLE, manager->state());
+  TEST_ASSERT_FALSE(runUntil(WIFI_CONN_EVENT_DROPPED, 5000));
+  TEST_ASSERT_EQUAL(WIFI_CONN_IDLE, manager->state());
+}
+
+void test_connect_time_percentiles() {
+  TEST_ASSERT_EQUAL(0, manager->connectTimePercentile(50));
+
+  const long times[] = {3000, 100, 200, 300, 400};
+  radio.scanMs = times[0];
+  manager->connect("office", "secret", radio.now);
+  TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 10000));
+  for (int i = 1; i < 5; i++) {
+    radio.fastMs = times[i];
+    radio.dropLink(0);
+    TEST_ASSERT_TRUE(runUntil(WIFI_CONN_EVENT_CONNECTED, 10000));
+  }
+
+  // Samples are measured in 50 ms ticks from the drop, one tick late
+  TEST_ASSERT_EQUAL(5, manager->connectTimeSamples());
+  TEST_ASSERT_UINT32_WITHIN(50, 300, manager->connectTimePercentile(50));
+  TEST_ASSERT_UINT32_WITHIN(50, 3000, manager->connectTimePercentile(90));
+  TEST_ASSERT_UINT32_WITHIN(50, 3000, manager->connectTimePercentile(100));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cold_connect_scans_and_fills_cache);
+  RUN_TEST(test_fast_connect_uses_cache);
+  RUN_TEST(test_cache_ignored_for_other_ssid);
+  RUN_TEST(test_fast_connect_falls_back_to_scan);
+  RUN_TEST(test_backoff_grows_with_jitter_and_is_capped);
+  RUN_TEST(test_reconnects_after_drop);
+  RUN_TEST(test_disconnect_stays_idle);
+  RUN_TEST(test_connect_time_percentiles);
+  return UNITY_END();
+}